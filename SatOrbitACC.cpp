@@ -3,11 +3,83 @@
 #include <stdio.h> // printf
 #include <math.h> // fmod
 #include <cmath> // sin cos acos
+#ifdef _OPENACC
 #include <accelmath.h>
+#endif
+#if defined(NUMA_WORKERS) || defined(PIPELINED)
+#include <pthread.h> // worker threads, pinned with pthread_attr_setaffinity_np
+#include <sched.h> // cpu_set_t sched_getaffinity sched_yield
+#include <stdlib.h> // posix_memalign free
+#include <string.h> // memset
+#include <time.h> // clock_gettime
+#endif
 #define PI 3.14159265358979323846
 
+// Synthetic constellation generator for scale testing. Build with e.g. -DSYNTHETIC_SATELLITES=100000 to replace
+// the 10 hand-entered TLEs with a generated population of that size. 0 uses load_sat_data as before
+#ifndef SYNTHETIC_SATELLITES
+#define SYNTHETIC_SATELLITES 0
+#endif
+#ifndef GENERATOR_SEED
+#define GENERATOR_SEED 20190501 // Same seed always gives the same population
+#endif
+#ifndef CONJUNCTION_FRACTION
+#define CONJUNCTION_FRACTION 0.01 // Fraction of generated objects placed right next to another object (near-conjunction pairs)
+#endif
+// Share of the generated population in each kind of orbit. Whatever is left over becomes debris
+#ifndef WALKER_FRACTION
+#define WALKER_FRACTION 0.60
+#endif
+#ifndef SSO_FRACTION
+#define SSO_FRACTION 0.15
+#endif
+#ifndef GEO_FRACTION
+#define GEO_FRACTION 0.05
+#endif
+#define TLE_MAX_CATALOG_NUMBER 339999 // Z9999 in Alpha-5, the largest catalog number a TLE file can hold
+// Largest number of time steps the main loop goes up to. Lower it for big populations, memory is satellites*time steps
+#ifndef MAX_TIME_STEPS
+#define MAX_TIME_STEPS 100000
+#endif
+
 // Define a data structure for the two-line element (TLE), a standard form of satellite position/trajectory
 // TLEs are available from "https://www.celestrak.com/NORAD/elements/". These are pulled from US government sources
+#ifdef FIXED_POINT_ANGLES
+// Fixed-point angles. Build with -DFIXED_POINT_ANGLES to propagate and screen the mean anomaly and perigee as
+// 32-bit fractions of a turn, where modulo 360 is just unsigned integer overflow. Each step's change in mean
+// anomaly is rounded to the nearest 1/2^32 turn (4.2e-8 degrees), so after t time steps the mean anomaly is within
+// (t+1)*4.2e-8 degrees of the double path (3.4e-3 degrees at 81920 steps). The one real difference: once drag takes
+// the mean motion below zero, fmod in the double path gives negative mean anomalies while turns stay in 0 to 360,
+// so collision counts only match while mean motion is positive
+#define DEGREES_PER_TURN_UNIT (360.0/4294967296.0) // one 1/2^32 of a turn in degrees
+
+#pragma acc routine seq
+unsigned int revolutions_to_turns(double revolutions);
+
+#pragma acc routine seq
+unsigned int degrees_to_turns(double degrees);
+
+#pragma acc routine seq
+double turns_to_degrees(unsigned int turns);
+
+// An angle kept only as turns. Assigning degrees converts them and reading it gives degrees back
+// (turns_to_degrees), so the TLE loaders, the generator and output work in degrees as before
+typedef struct turn_angle{
+  unsigned int turns; // fixed-point fraction of a turn, 2^32 = 360 degrees
+
+#pragma acc routine seq
+  turn_angle &operator=(double degrees){
+    turns = degrees_to_turns(degrees);
+    return *this;
+  }
+
+#pragma acc routine seq
+  operator double() const {
+    return turns_to_degrees(turns);
+  }
+} turn_angle;
+#endif
+
 typedef struct param_TLE{
   // satellite name
   int sat_num; // A unique number identifying that satellite 
@@ -16,15 +88,302 @@ typedef struct param_TLE{
   double raan; //right ascension of the ascending node. in degrees
   double eccentricity; // Basically, how circular is it.Range- 0, perfectly circular; 0<eccentricity<1, elliptical;
   // =1, parabolic and is called the 'escape orbit'/'capture orbit'; >1 is hyperbolic
+#ifdef FIXED_POINT_ANGLES
+  turn_angle perigee; // In turns, reads and assigns as degrees
+  turn_angle mean_anomaly;
+  unsigned int padding[2]; // The two angles are 8 bytes less than the doubles, this keeps the struct at 64 bytes
+#else
   double perigee; // This is the argument of perigee. Basically at what point is the satellite closest to the body it 
   //is orbiting. In degrees
   double mean_anomaly; // How long, in degrees, it has been since the satellite was at perigee.  
+#endif
   double mean_motion; // A measurement of speed, denotes how many times a day the satellite would orbit if you made
   // its speed constant. In revolutions per day
   double drag; // First Time Derivative of mean motion divied by two. Generally positive but can be negative
   // if there are weird effects such as alignment of moon and sun with satellite at a certain time to pull it up
 } param_TLE;
 
+// One cache line. NUMA time blocks also rely on it dividing a page
+static_assert(sizeof(param_TLE) == 64, "param_TLE should be 64 bytes");
+
+// Orbit classes. Satellites are partitioned by eccentricity once at load time (partition_by_orbit_class) and each
+// class runs its own compile-time specialized propagation kernel, propagate_sat_step<orbit class>
+#ifndef NEAR_CIRCULAR_MAX_ECCENTRICITY
+#define NEAR_CIRCULAR_MAX_ECCENTRICITY 0.01
+#endif
+#ifndef HIGHLY_ECCENTRIC_MIN_ECCENTRICITY
+#define HIGHLY_ECCENTRIC_MIN_ECCENTRICITY 0.3
+#endif
+enum orbit_class {NEAR_CIRCULAR = 0, MODERATELY_ECCENTRIC = 1, HIGHLY_ECCENTRIC = 2, NUMBER_OF_ORBIT_CLASSES = 3};
+
+// Eccentricity at the next time step from e = (eccentric anomaly - mean anomaly)/sin(eccentric anomaly).
+// The general path is the one used for highly eccentric orbits, the others are cheaper forms of the same thing.
+// Tolerances below hold away from perigee and apogee, where sin(eccentric anomaly) -> 0 and the general path is 0/0
+#pragma acc routine seq
+template <int ORBIT_CLASS>
+double next_eccentricity(double eccentricity, double mean_anomaly_radians){
+  double true_anomaly_rads; // What is the actual angle for the elliptical orbit. For circular orbits, mean_anomaly=true_anomaly
+  double eccentric_anomaly_radians;
+  double anomaly_difference;
+
+  // Simplified for true anomaly. Getting the accurate true anomaly from mean anomaly requires a numerical method, no analytical solution exists. All values in radians
+  // true_anomaly = mean_anomaly + 2*eccentricity*sin(mean_anomaly) + 1.25 * (eccentricity^2) * sin(2*mean_anomaly)
+  true_anomaly_rads = mean_anomaly_radians + 2*eccentricity*sin(mean_anomaly_radians) + 1.25 * (eccentricity*eccentricity)*sin(2*mean_anomaly_radians);
+
+  // cos-1((eccentricity+cos(true_anomaly_rads))/(1+eccentricity*cos(true_anomaly_rads)))
+  eccentric_anomaly_radians = acos((eccentricity+cos(true_anomaly_rads))/(1.0 + eccentricity*cos(true_anomaly_rads)));
+  // acos only gives 0 to pi. The eccentric anomaly is in the same half of the orbit as the true anomaly
+  if (sin(true_anomaly_rads) < 0){
+    eccentric_anomaly_radians = 2*PI - eccentric_anomaly_radians;
+  }
+
+  // Difference between the two anomalies, across the 0/2pi wrap if needed
+  anomaly_difference = eccentric_anomaly_radians - mean_anomaly_radians;
+  if (anomaly_difference > PI) anomaly_difference -= 2*PI;
+  if (anomaly_difference < -PI) anomaly_difference += 2*PI;
+
+  // e = (eccentric anomaly - mean anomaly)/sin(eccentric anomaly)
+  return anomaly_difference/sin(eccentric_anomaly_radians);
+}
+
+// Near-circular: the general path written as a series in e up to e^5. One sin/cos pair, no branches and no 0/0
+// at the apsides. Each step is within about e^6 of the general path, and since every step feeds the next that is what
+// matters over a run: 81920 steps from e=0.0099 end at 0.00261 on both, at most 4e-10 apart. Within ~0.02 degrees of
+// perigee or apogee the general path itself loses up to ~1e-6 to rounding (acos near 1, then 0/0), so runs that land
+// that close to an apsis agree to a few 1e-6 (RADIX 1e-6, a GEO orbit at e=0.005 3e-6)
+#pragma acc routine seq
+template <>
+double next_eccentricity<NEAR_CIRCULAR>(double eccentricity, double mean_anomaly_radians){
+  double sin_mean = sin(mean_anomaly_radians);
+  double cos_mean = cos(mean_anomaly_radians);
+  double sin_squared = sin_mean*sin_mean;
+  double e_squared = eccentricity*eccentricity;
+
+  // e + e^3*(13/3 sin^2 M - 3) + e^4*cos M*(135 - 106 sin^2 M)/24 + e^5*(5.3 sin^4 M + 23/24 sin^2 M - 33/8)
+  return eccentricity*(1 + e_squared*((13.0/3*sin_squared - 3) + eccentricity*cos_mean*(135 - 106*sin_squared)/24
+				      + e_squared*(5.3*sin_squared*sin_squared + 23.0/24*sin_squared - 33.0/8)));
+}
+
+// Moderately eccentric: same result as the general path up to rounding (~1e-12). One sin/cos pair per anomaly, sin(E) and
+// the quadrant come straight from the true anomaly instead of acos and two more sin calls
+#pragma acc routine seq
+template <>
+double next_eccentricity<MODERATELY_ECCENTRIC>(double eccentricity, double mean_anomaly_radians){
+  double sin_mean = sin(mean_anomaly_radians);
+  double cos_mean = cos(mean_anomaly_radians);
+  double true_anomaly_rads;
+  double sin_true;
+  double cos_true;
+  double denominator;
+  double sin_eccentric;
+  double anomaly_difference;
+
+  // sin(2*mean_anomaly) = 2*sin(mean_anomaly)*cos(mean_anomaly)
+  true_anomaly_rads = mean_anomaly_radians + 2*eccentricity*sin_mean + 2.5 * (eccentricity*eccentricity)*sin_mean*cos_mean;
+  sin_true = sin(true_anomaly_rads);
+  cos_true = cos(true_anomaly_rads);
+
+  // cos(E) = (e+cos(v))/(1+e*cos(v)) and sin(E) = sqrt(1-e^2)*sin(v)/(1+e*cos(v))
+  denominator = 1.0 + eccentricity*cos_true;
+  sin_eccentric = sqrt(1.0 - eccentricity*eccentricity)*sin_true/denominator;
+
+  anomaly_difference = atan2(sin_eccentric, (eccentricity + cos_true)/denominator) - mean_anomaly_radians;
+  // atan2 gives -pi to pi, bring the difference back next to 0
+  if (anomaly_difference > PI) anomaly_difference -= 2*PI;
+  if (anomaly_difference < -PI) anomaly_difference += 2*PI;
+
+  return anomaly_difference/sin_eccentric;
+}
+
+// Propagates one satellite by one time step. Everything apart from the eccentricity is the same for every class
+#pragma acc routine seq
+template <int ORBIT_CLASS>
+void propagate_sat_step(const param_TLE &current_sat_TLE, param_TLE &next_time_sat_TLE, int time_step_size){
+#ifndef FIXED_POINT_ANGLES
+  double motion_deg; // Mean motion converted from revolutions per day to degrees per day
+#endif
+
+  // Without thrust or any unexpected force, inclination, raan, perigee, drag and sat_num don't change
+  next_time_sat_TLE = current_sat_TLE;
+
+  next_time_sat_TLE.mean_motion = current_sat_TLE.mean_motion - current_sat_TLE.drag*time_step_size;
+
+  // Simplified to circular
+  // new_anomaly=(mean_motion*(time_step_size) + current_anomaly)modulo(360)
+  // modulo(360) as mean_anomaly bounded by 0 and 360 since it's just tracking how far along an ellipse you are
+  // note: time_step_size can be used as given or caclculated by (end_time-start_time)
+#ifdef FIXED_POINT_ANGLES
+  // Modulo 360 is the unsigned overflow
+  next_time_sat_TLE.mean_anomaly.turns = current_sat_TLE.mean_anomaly.turns + revolutions_to_turns(current_sat_TLE.mean_motion*time_step_size);
+
+  next_time_sat_TLE.eccentricity = next_eccentricity<ORBIT_CLASS>(current_sat_TLE.eccentricity, current_sat_TLE.mean_anomaly.turns*(DEGREES_PER_TURN_UNIT*PI/180));
+#else
+  motion_deg = current_sat_TLE.mean_motion*360; // converts mean_motion from revolutions per day to degrees per day
+  next_time_sat_TLE.mean_anomaly = fmod(motion_deg*(time_step_size) + current_sat_TLE.mean_anomaly, 360);
+
+  next_time_sat_TLE.eccentricity = next_eccentricity<ORBIT_CLASS>(current_sat_TLE.eccentricity, current_sat_TLE.mean_anomaly*PI/180);
+#endif
+}
+
+#ifdef NUMA_WORKERS
+// NUMA-aware CPU build (see the SatOrbitNUMA make target). Instead of the OpenACC loops, pinned worker threads
+// do the propagation and screening. Each NUMA node owns a block of time steps of every satellite's row,
+// first-touches it so the pages are allocated on that node, and screens only its own time steps
+#ifndef NUMA_MAX_NODES
+#define NUMA_MAX_NODES 16
+#endif
+#ifndef NUMA_MAX_CPUS
+#define NUMA_MAX_CPUS 1024 // per node
+#endif
+#ifndef NUMA_THREADS_PER_NODE
+#define NUMA_THREADS_PER_NODE 0 // 0 is one worker per cpu of the node
+#endif
+#ifndef NUMA_CHUNK_SATS
+#define NUMA_CHUNK_SATS 64 // satellites handed from one node to the next at a time while propagating
+#endif
+#define NUMA_PAGE_BYTES 4096
+#define NUMA_PAGE_STEPS (NUMA_PAGE_BYTES/sizeof(param_TLE)) // time steps in one page of a row. Time blocks start on a page
+
+enum numa_job_type {NUMA_FIRST_TOUCH = 0, NUMA_PROPAGATE = 1, NUMA_SCREEN = 2};
+
+typedef struct numa_node_info{
+  int node; // node number under /sys/devices/system/node
+  int number_of_cpus;
+  int cpus[NUMA_MAX_CPUS];
+  int first_step; // This node holds time steps first_step to last_step-1 of every row
+  int last_step;
+  // Run summary
+  double touched_bytes;
+  double propagate_bytes;
+  double propagate_seconds;
+  double screen_bytes;
+  double screen_seconds;
+} numa_node_info;
+
+// Everything the workers of one numa_run call share
+typedef struct numa_job{
+  int job_type;
+  numa_node_info *nodes;
+  int number_of_nodes;
+  param_TLE **sat_array;
+  int number_of_sats;
+  int number_of_t_steps;
+  int time_step_size;
+  const int *class_sats; // satellites listed by orbit class, from partition_by_orbit_class
+  const int *class_start;
+  int *chunk_block; // Propagation wavefront. Next node allowed to work on each chunk of NUMA_CHUNK_SATS satellites
+  int number_of_chunks;
+} numa_job;
+
+typedef struct numa_worker{
+  pthread_t thread;
+  numa_job *job;
+  int node; // index into job->nodes
+  int node_rank; // 0 to node_workers-1 inside its node
+  int node_workers;
+  long long risks; // collision risks found while screening
+  double bytes;
+  double seconds;
+} numa_worker;
+#endif
+
+#ifdef PIPELINED
+// Pipelined CPU build (see the SatOrbitPipeline make target). Time is cut into blocks of PIPELINE_BLOCK_STEPS
+// and a few worker threads propagate block k+1, screen block k and write out block k-1's collision risks
+// at the same time. Only two blocks of satellite states and fixed size event lists are held at once.
+//
+// GPU plan (not built yet; the OpenACC build keeps the whole matrix on the device and runs its loops in order).
+// The same blocks map onto async queues instead of threads. A wait on a queue waits for all of it, so screening
+// alternates between two queues by block parity. For block k:
+//  1. #pragma acc wait(2 + k%2) async(1) - slot k%2 is free once block k-2 is screened
+//  2. propagate block k into device slot k%2 with the per-class parallel loops, async(1)
+//  3. #pragma acc wait(1) async(2 + k%2), then screen block k into device event buffer k%2, async(2 + k%2).
+//     Events go in through an atomic counter capped at PIPELINE_EVENT_CAPACITY. A block that overflows records
+//     the time step it reached and the host screens the rest of it again after draining (the backpressure)
+//  4. on the host, #pragma acc wait(2 + (k-1)%2) and update self block k-1's events, then write them while
+//     the device propagates block k+1 and screens block k
+#ifndef PIPELINE_BLOCK_STEPS
+#define PIPELINE_BLOCK_STEPS 256
+#endif
+#ifndef PIPELINE_THREADS
+#define PIPELINE_THREADS 3
+#endif
+#ifndef PIPELINE_SCREEN_TASKS
+#define PIPELINE_SCREEN_TASKS 4 // screening of a block is split into this many tasks so several threads can share it
+#endif
+#ifndef PIPELINE_EVENTS_FILE
+#define PIPELINE_EVENTS_FILE "collision_risk_events.txt"
+#endif
+#ifndef PIPELINE_EVENT_CAPACITY
+#define PIPELINE_EVENT_CAPACITY 65536 // collision risks each screening task holds before it has to wait for them to be written
+#endif
+
+enum pipeline_task_type {PIPELINE_PROPAGATE = 0, PIPELINE_SCREEN = 1, PIPELINE_WRITE = 2, PIPELINE_DONE = 3};
+
+typedef struct collision_event{
+  int time_step;
+  int sat1; // sat_num of both satellites
+  int sat2;
+} collision_event;
+
+// Fixed size, PIPELINE_EVENT_CAPACITY events. Reused from block to block
+typedef struct event_list{
+  collision_event *events;
+  int count;
+  bool full; // screening task is waiting for the list to be written out
+  bool done; // screening task has finished, the list is written out and then the next one
+} event_list;
+
+typedef struct pipeline{
+  param_TLE **initial; // time step 0 of each satellite
+  int number_of_sats;
+  int number_of_t_steps;
+  int time_step_size;
+  const int *class_sats; // satellites listed by orbit class, from partition_by_orbit_class
+  const int *class_start;
+  int number_of_blocks;
+
+  // Double buffers. Block k uses slot k%2. States are stored a time step at a time: state[slot][b*number_of_sats + sat]
+  param_TLE *state[2];
+  event_list events[2][PIPELINE_SCREEN_TASKS]; // one list per screening task so tasks don't share
+  FILE *events_file;
+
+  // Task scheduler, everything below is protected by lock
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  int blocks_propagated;
+  bool propagating;
+  int next_screen; // block being handed out to screening tasks
+  int screen_tasks_started; // of next_screen
+  int *screen_tasks_done; // per block
+  int blocks_written;
+  int write_task; // next list of block blocks_written to write, lists are written in time step order
+  bool writing;
+  long long risks;
+  double stage_seconds[3]; // time spent in each kind of task
+} pipeline;
+#endif
+
+#if defined(NUMA_WORKERS) && defined(PIPELINED)
+#error "NUMA_WORKERS and PIPELINED are separate builds"
+#endif
+
+#ifdef ANALYTIC_SCREENING
+// Analytic pair screening. Instead of checking every pair at every time step, each pair works out the time steps
+// where collision_risk can pass (analytic_pair_risks) and only checks those on the propagated states
+#ifndef ANALYTIC_MAX_STRIDE
+#define ANALYTIC_MAX_STRIDE 32 // largest step stride tried to turn a fast relative phase into a slowly drifting one
+#endif
+#ifndef ANALYTIC_PHASE_MARGIN
+#define ANALYTIC_PHASE_MARGIN 0.1 // degrees, at 100000 time steps. Covers rounding the time stepping builds up against the closed form
+#endif
+#define ANALYTIC_ROOT_COST 4 // a window solved with square roots costs about this many collision_risk calls
+#endif
+
+#if defined(ANALYTIC_SCREENING) && defined(PIPELINED)
+#error "ANALYTIC_SCREENING needs every time step of a pair at once, the pipeline only keeps two blocks"
+#endif
+
 bool collision_risk(param_TLE sat1, param_TLE sat2);
 
 //double altitude_calc(double mean_motion);
@@ -32,12 +391,47 @@ bool collision_risk(param_TLE sat1, param_TLE sat2);
 int load_sat_data(param_TLE **sat_array, int number_of_sats, int number_of_t_steps);
 // void *sat_array_in
 
+int generate_sat_data(param_TLE **sat_array, int number_of_sats, unsigned long long seed, double conjunction_fraction);
+
+int write_tle_file(const char *file_name, param_TLE **sat_array, int number_of_sats);
+
+int orbit_class_of(double eccentricity);
+
+int partition_by_orbit_class(param_TLE **sat_array, int number_of_sats, int *class_sats, int *class_start);
+
+#ifdef ANALYTIC_SCREENING
+#pragma acc routine seq
+int analytic_pair_risks(param_TLE **sat_array, int sat1, int sat2, int first_step, int last_step, int time_step_size, long long *checked_steps);
+#endif
+
+#ifdef NUMA_WORKERS
+int numa_topology(numa_node_info *nodes, int max_nodes);
+
+void numa_assign_time_blocks(numa_node_info *nodes, int number_of_nodes, int number_of_t_steps);
+
+param_TLE **numa_alloc_sat_array(numa_node_info *nodes, int number_of_nodes, int number_of_sats, int number_of_t_steps);
+
+void numa_free_sat_array(param_TLE **sat_array, int number_of_sats);
+
+long long numa_run(numa_job *job);
+
+void numa_report(numa_node_info *nodes, int number_of_nodes);
+#endif
+
+#ifdef PIPELINED
+long long pipeline_run(param_TLE **initial, int number_of_sats, int number_of_t_steps, int time_step_size, const int *class_sats, const int *class_start);
+#endif
+
 int main(){
 
-  for(int number_of_time_steps = 10; number_of_time_steps < 100000; number_of_time_steps*=2){
+  for(int number_of_time_steps = 10; number_of_time_steps < MAX_TIME_STEPS; number_of_time_steps*=2){
     // int number_of_time_steps = 8000; // How far in the future do you want to propogate 
 
+#if SYNTHETIC_SATELLITES
+  int number_of_satellites = SYNTHETIC_SATELLITES; // Generated population
+#else
  int number_of_satellites = 10; // How many satellites are you analyzing
+#endif
 
   // OpenACC initialize
   #pragma acc init
@@ -48,16 +442,40 @@ int main(){
   // Initialize an array with a row for each satellite and a column for each time step
   param_TLE** sats_over_time;
 
+#ifdef NUMA_WORKERS
+  // Rows are allocated here but only first-touched by the workers of the node that owns each time block
+  static numa_node_info numa_nodes[NUMA_MAX_NODES];
+  int number_of_numa_nodes = numa_topology(numa_nodes, NUMA_MAX_NODES);
+  numa_assign_time_blocks(numa_nodes, number_of_numa_nodes, number_of_time_steps);
+  sats_over_time = numa_alloc_sat_array(numa_nodes, number_of_numa_nodes, number_of_satellites, number_of_time_steps);
+  if (sats_over_time == NULL) return 1;
+#elif defined(PIPELINED)
+  // Only the initial conditions. The pipeline keeps two blocks of time steps at a time itself
+  sats_over_time = new param_TLE*[number_of_satellites];
+
+  for(int i=0; i<number_of_satellites; i++){
+    sats_over_time[i] = new param_TLE[1];
+  }
+#else
   sats_over_time = new param_TLE*[number_of_satellites];
 
   for(int i=0; i<number_of_satellites; i++){
     sats_over_time[i] = new param_TLE[number_of_time_steps];
   }
+#endif
   //param_TLE sats_over_time[number_of_satellites][number_of_time_steps];
   //  bool collision_risk_over_time[number_of_time_steps][number_of_satellites][number_of_satellites];
 
   // Use function to load satellite data into TLE array made above
+#if SYNTHETIC_SATELLITES
+  generate_sat_data(sats_over_time, number_of_satellites, GENERATOR_SEED, CONJUNCTION_FRACTION);
+#ifdef WRITE_TLE_FILE
+  // e.g. -DWRITE_TLE_FILE=\"synthetic.tle\" to keep a copy of the generated population for other tools
+  write_tle_file(WRITE_TLE_FILE, sats_over_time, number_of_satellites);
+#endif
+#else
   load_sat_data(sats_over_time, number_of_satellites, number_of_time_steps);
+#endif
 
   // Display size of array. # of rows = number of satellites and # of columns = number of time steps 
   //  printf("Number of Satellites:%d | Number of Time Steps:%d\n", sizeof(sats_over_time)/sizeof(sats_over_time[0]), sizeof(sats_over_time[0])/sizeof(sats_over_time[0][0]));
@@ -66,72 +484,95 @@ int main(){
   //  printf("Sanity check: %d\n", sats_over_time[0][0].sat_num);
 
   
-  // Go through each time step. -1 as the first time step is filled with the initial conditions
+  // Group satellites by orbit class so each class can run its own kernel
+  int* class_sats = new int[number_of_satellites];
+  int class_start[NUMBER_OF_ORBIT_CLASSES+1];
+  partition_by_orbit_class(sats_over_time, number_of_satellites, class_sats, class_start);
+  printf("Near-circular: %d | Moderately eccentric: %d | Highly eccentric: %d\n", class_start[1]-class_start[0], class_start[2]-class_start[1], class_start[3]-class_start[2]);
 
-  double motion_deg; // Mean motion converted from revolutions per day to degrees per day
-  double true_anomaly_rads; // What is the actual angle for the elliptical orbit. For circular orbits, mean_anomaly=true_anomaly
-  double mean_anomaly_radians; // Needs to be in radians for sin
-  double eccentric_anomaly_radians;
+#ifdef NUMA_WORKERS
+  numa_job job;
+  job.nodes = numa_nodes;
+  job.number_of_nodes = number_of_numa_nodes;
+  job.sat_array = sats_over_time;
+  job.number_of_sats = number_of_satellites;
+  job.number_of_t_steps = number_of_time_steps;
+  job.time_step_size = time_step_size;
+  job.class_sats = class_sats;
+  job.class_start = class_start;
 
-#pragma acc data copy(sats_over_time[0:number_of_satellites][0:number_of_time_steps]) 
+  job.job_type = NUMA_PROPAGATE;
+  numa_run(&job);
+#elif defined(PIPELINED)
+  // Propagated block by block inside pipeline_run, at the same time as screening
+#else
+  // The satellite array goes to the device once here and stays there for screening, until the exit data below
+#pragma acc enter data copyin(sats_over_time[0:number_of_satellites][0:number_of_time_steps], class_sats[0:number_of_satellites])
 
+  // Go through each time step. -1 as the first time step is filled with the initial conditions
   for (int time_loops= 0; time_loops < (number_of_time_steps-1); time_loops++){
-      // Parallelize for each satellite as those are independent
-      #pragma acc parallel loop 
-
+#ifdef GENERIC_PROPAGATION
+    // Everything through the general path, to check the specialized kernels against
+    #pragma acc parallel loop
     for(int sat_loops= 0; sat_loops<number_of_satellites; sat_loops++){
-	param_TLE current_sat_TLE = sats_over_time[sat_loops][time_loops];
-	param_TLE next_time_sat_TLE = sats_over_time[sat_loops][time_loops+1];
-
-	// Want to parallelize each calculation as each only depends on current
-	// Without thrust or any unexpected force, several variables don't change    
-	next_time_sat_TLE.inclination = current_sat_TLE.inclination;
-	
-	next_time_sat_TLE.raan = current_sat_TLE.raan;
-
-	next_time_sat_TLE.perigee = current_sat_TLE.perigee;
-
-	next_time_sat_TLE.mean_motion = current_sat_TLE.mean_motion - current_sat_TLE.drag*time_step_size;
+      propagate_sat_step<HIGHLY_ECCENTRIC>(sats_over_time[sat_loops][time_loops], sats_over_time[sat_loops][time_loops+1], time_step_size);
+    }
+#else
+    // Parallelize for each satellite as those are independent. One loop per orbit class
+    #pragma acc parallel loop
+    for(int class_loops= class_start[NEAR_CIRCULAR]; class_loops<class_start[NEAR_CIRCULAR+1]; class_loops++){
+      int sat_loops = class_sats[class_loops];
+      propagate_sat_step<NEAR_CIRCULAR>(sats_over_time[sat_loops][time_loops], sats_over_time[sat_loops][time_loops+1], time_step_size);
+    }
 
-  // Simplified to circular
-  // new_anomaly=(mean_motion*(time_step_size) + current_anomaly)modulo(360)
-  // modulo(360) as mean_anomaly bounded by 0 and 360 since it's just tracking how far along an ellipse you are
-  // note: time_step_size can be used as given or caclculated by (end_time-start_time)
-	  motion_deg = current_sat_TLE.mean_motion*360; // converts mean_motion from revolutions per day to degrees per day
-	 
-	next_time_sat_TLE.mean_anomaly = fmod(motion_deg*(time_step_size) + current_sat_TLE.mean_anomaly, 360);
+    #pragma acc parallel loop
+    for(int class_loops= class_start[MODERATELY_ECCENTRIC]; class_loops<class_start[MODERATELY_ECCENTRIC+1]; class_loops++){
+      int sat_loops = class_sats[class_loops];
+      propagate_sat_step<MODERATELY_ECCENTRIC>(sats_over_time[sat_loops][time_loops], sats_over_time[sat_loops][time_loops+1], time_step_size);
+    }
 
-  // Simplified for true anomaly. Getting the accurate true anomaly from mean anomaly requires a numerical method, no analytical solution exists. All values in radians
-  // true_anomaly = mean_anomaly + 2*eccentricity*sin(mean_anomaly) + 1.25 * (eccentricity^2) * sin(2*mean_anomaly)
-	mean_anomaly_radians = current_sat_TLE.mean_anomaly*PI/180;
-	true_anomaly_rads = mean_anomaly_radians + 2*current_sat_TLE.eccentricity*sin(mean_anomaly_radians) + 1.25 * (current_sat_TLE.eccentricity*current_sat_TLE.eccentricity)*sin(2*mean_anomaly_radians);
-  
-  // cos-1((eccentricity+cos(true_anomaly_rads))/(1+eccentricity*cos(true_anomaly_rads)))
+    #pragma acc parallel loop
+    for(int class_loops= class_start[HIGHLY_ECCENTRIC]; class_loops<class_start[HIGHLY_ECCENTRIC+1]; class_loops++){
+      int sat_loops = class_sats[class_loops];
+      propagate_sat_step<HIGHLY_ECCENTRIC>(sats_over_time[sat_loops][time_loops], sats_over_time[sat_loops][time_loops+1], time_step_size);
+    }
+#endif
+  }
 
-  eccentric_anomaly_radians = acos((current_sat_TLE.eccentricity+cos(true_anomaly_rads))/(1.0 + current_sat_TLE.eccentricity*cos(true_anomaly_rads)));
+#endif
 
+  // Calculate collision risks
 
-   // e = (eccentric anomaly - mean anomaly)/sin(eccentric anomaly)
+#if defined(NUMA_WORKERS) || defined(PIPELINED) || defined(ANALYTIC_SCREENING)
+  long long collision_risk_counter = 0; // grows with the square of the satellites, past int for big populations
+#else
+  int collision_risk_counter = 0;
+#endif
 
-	next_time_sat_TLE.eccentricity = (eccentric_anomaly_radians - mean_anomaly_radians)/sin(eccentric_anomaly_radians);
-	
-	  next_time_sat_TLE.drag = current_sat_TLE.drag;
-	
-	next_time_sat_TLE.sat_num = current_sat_TLE.sat_num; // This value doesn't change
-	
-	//	altitude_calc(current_sat_TLE.mean_motion);
+#ifdef NUMA_WORKERS
+  job.job_type = NUMA_SCREEN;
+  collision_risk_counter = numa_run(&job);
+#elif defined(PIPELINED)
+  collision_risk_counter = pipeline_run(sats_over_time, number_of_satellites, number_of_time_steps, time_step_size, class_sats, class_start);
+#elif defined(ANALYTIC_SCREENING)
+  // Each pair works out its own risk steps and only checks those
+  long long checked_steps = 0;
 
-	// Update
-	sats_over_time[sat_loops][time_loops+1] = next_time_sat_TLE;
-      }
+#pragma acc data present(sats_over_time[0:number_of_satellites][0:number_of_time_steps]) copy(collision_risk_counter, checked_steps)
+#pragma acc parallel loop reduction(+:collision_risk_counter,checked_steps)
+  for(int sat_loops=0; sat_loops<(number_of_satellites-1); sat_loops++){
+    for(int compare_loops = sat_loops+1; compare_loops < number_of_satellites ; compare_loops++){
+      long long pair_checked_steps = 0;
+      collision_risk_counter += analytic_pair_risks(sats_over_time, sat_loops, compare_loops, 1, number_of_time_steps, time_step_size, &pair_checked_steps);
+      checked_steps += pair_checked_steps;
     }
+  }
 
-  // Calculate collision risks
-
+  printf("Analytic screening checked %lld of %lld pair time steps\n", checked_steps, (long long)number_of_satellites*(number_of_satellites-1)/2*(number_of_time_steps-1));
+#else
   bool collision;
-  int collision_risk_counter = 0;
 
-#pragma acc data copy(sats_over_time[0:number_of_satellites][0:number_of_time_steps]) copy(collision_risk_counter) 
+#pragma acc data present(sats_over_time[0:number_of_satellites][0:number_of_time_steps]) copy(collision_risk_counter) 
 // Go through each time step. Start at 1 as the first time step (0) is filled with the initial conditions
   for (int t_loops=1; t_loops<number_of_time_steps; t_loops++){
       // Parallelize for each satellite as those are independent
@@ -154,14 +595,29 @@ int main(){
     } 
   }
   
-  for(int i = 1; i < number_of_satellites; i++){
+#endif
+
+#if !defined(NUMA_WORKERS) && !defined(PIPELINED)
+  // Only the count comes back, the propagated states aren't needed on the host
+#pragma acc exit data delete(sats_over_time[0:number_of_satellites][0:number_of_time_steps], class_sats[0:number_of_satellites])
+#endif
+  
+#ifdef NUMA_WORKERS
+  numa_free_sat_array(sats_over_time, number_of_satellites);
+#else
+  for(int i = 0; i < number_of_satellites; i++){
     delete[] sats_over_time[i];
   }
   delete[] sats_over_time;
+#endif
+  delete[] class_sats;
   
   //free(collision_risk_over_time);
 
-  printf("Number of collison risks identified: %d\n", collision_risk_counter);  
+  printf("Number of collison risks identified: %lld\n", (long long)collision_risk_counter);  
+#ifdef NUMA_WORKERS
+  numa_report(numa_nodes, number_of_numa_nodes);
+#endif
 
   }
   return 0;
@@ -187,9 +643,11 @@ double altitude_calc(double mean_motion){
 bool collision_risk(param_TLE sat1, param_TLE sat2){
   bool motion_check;
   bool anomaly_check;
+#ifndef FIXED_POINT_ANGLES
   double degrees_to_rads = PI/180;
   double sat1_pos;
   double sat2_pos;
+#endif
 
   if (sat1.mean_motion/sat2.mean_motion > 0.98 & sat1.mean_motion/sat2.mean_motion < 1.02){
     motion_check = true;
@@ -197,6 +655,15 @@ bool collision_risk(param_TLE sat1, param_TLE sat2){
     motion_check = false;
   }
 
+#ifdef FIXED_POINT_ANGLES
+  // In turns, up to 2 turns so 64 bit. sat1_pos/sat2_pos between 0.98 and 1.02 is the same as
+  // 49*sat2_pos < 50*sat1_pos < 51*sat2_pos, i.e. |50*(sat1_pos - sat2_pos)| < sat2_pos. No conversions or divisions
+  long long sat1_turns = (long long)sat1.mean_anomaly.turns + sat1.perigee.turns;
+  long long sat2_turns = (long long)sat2.mean_anomaly.turns + sat2.perigee.turns;
+  long long difference = 50*(sat1_turns - sat2_turns);
+
+  anomaly_check = difference < sat2_turns && -difference < sat2_turns;
+#else
   sat1_pos = sat1.mean_anomaly*degrees_to_rads+sat1.perigee*degrees_to_rads;
   sat2_pos = sat2.mean_anomaly*degrees_to_rads+sat2.perigee*degrees_to_rads;
 
@@ -205,6 +672,7 @@ bool collision_risk(param_TLE sat1, param_TLE sat2){
   } else {
     anomaly_check = false;
   }
+#endif
 
   if (motion_check == true & anomaly_check == true) {
     return true;
@@ -363,3 +831,1226 @@ int load_sat_data(param_TLE **sat_array, int number_of_sats, int number_of_t_ste
 
 
 
+
+// Deterministic pseudo-random numbers (splitmix64) so the same seed always gives the same population.
+// Returns a double uniformly spread between low and high
+double generator_uniform(unsigned long long *state, double low, double high){
+  unsigned long long z;
+
+  *state += 0x9E3779B97F4A7C15ULL;
+  z = *state;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+
+  return low + (high-low)*((z >> 11)*(1.0/9007199254740992.0)); // top 53 bits -> [0,1)
+}
+
+double mean_motion_from_altitude(double altitude_km){
+  // Circular orbit: mean motion = sqrt(mu/a^3), converted from radians per second to revolutions per day
+  double mu = 398600.4418; // Earth's gravitational parameter in km^3/s^2
+  double a = 6378.137 + altitude_km; // semi-major axis, km
+
+  return sqrt(mu/(a*a*a))*86400/(2*PI);
+}
+
+double sso_inclination(double altitude_km){
+  // Sun-synchronous when J2 precession of the raan matches the Earth's motion around the sun (~0.9856 deg/day)
+  // cos(i) = -(a/12352 km)^(7/2) for a circular orbit
+  double a = 6378.137 + altitude_km;
+
+  return acos(-pow(a/12352.0, 3.5))*180/PI;
+}
+
+// Fills sat_array[i][0] for every satellite with a synthetic population: Walker-delta shells, sun-synchronous planes,
+// a GEO belt and debris clouds (including some highly eccentric transfer-orbit fragments). A conjunction_fraction
+// of the objects are then moved right next to another object so both the mean motion and position ratio tests
+// in collision_risk pass for that pair at the first time step
+int generate_sat_data(param_TLE **sat_array, int number_of_sats, unsigned long long seed, double conjunction_fraction){
+  unsigned long long state = seed;
+  param_TLE sat;
+  int walker_count = (int)(number_of_sats*WALKER_FRACTION);
+  int sso_count = (int)(number_of_sats*SSO_FRACTION);
+  int geo_count = (int)(number_of_sats*GEO_FRACTION);
+  int debris_start;
+  int i = 0;
+
+  if (walker_count + sso_count + geo_count > number_of_sats){
+    printf("Population fractions add up to more than 1\n");
+    return 1;
+  }
+
+  sat.epoch = 0;
+
+  /* Walker-delta shells i:t/p/f. Each shell has p planes evenly spread in raan, t/p satellites evenly spread
+     in each plane and neighbouring planes offset by f*360/t degrees */
+  double shell_altitude[4] = {550.0, 540.0, 570.0, 560.0}; // km
+  double shell_inclination[4] = {53.0, 53.2, 70.0, 97.6}; // degrees
+  int number_of_shells = 4;
+
+  for(int shell = 0; shell < number_of_shells; shell++){
+    int t = walker_count/number_of_shells + (shell < walker_count%number_of_shells ? 1 : 0);
+    int p = (int)sqrt((double)t); // roughly square shells, like 72 planes of 22
+    int f = 1;
+    int sats_per_plane;
+
+    if (t == 0) continue;
+    if (p < 1) p = 1;
+    sats_per_plane = (t + p - 1)/p;
+
+    for(int k = 0; k < t; k++, i++){
+      int plane = k/sats_per_plane;
+      int slot = k%sats_per_plane;
+
+      sat.sat_num = i + 1;
+      sat.inclination = shell_inclination[shell];
+      sat.raan = 360.0*plane/p;
+      sat.eccentricity = generator_uniform(&state, 0.0001, 0.0015);
+      sat.perigee = generator_uniform(&state, 0, 360);
+      sat.mean_anomaly = fmod(360.0*slot/sats_per_plane + 360.0*f*plane/t + 360 - sat.perigee, 360);
+      sat.mean_motion = mean_motion_from_altitude(shell_altitude[shell]);
+      sat.drag = generator_uniform(&state, 0.0001, 0.002);
+      sat_array[i][0] = sat;
+    }
+  }
+
+  /* Sun-synchronous planes, each at its own altitude and local time (raan) */
+  int sso_planes = sso_count/40 + 1; // around 40 satellites per plane
+  for(int k = 0; k < sso_count; k++, i++){
+    int plane = k%sso_planes;
+    int sats_in_plane = sso_count/sso_planes + 1;
+    // The plane's altitude only depends on the plane so every satellite in it agrees
+    unsigned long long plane_state = seed ^ (0x5DEECE66DULL*(plane + 1));
+    double altitude = generator_uniform(&plane_state, 500, 800);
+
+    sat.sat_num = i + 1;
+    sat.inclination = sso_inclination(altitude);
+    sat.raan = 360.0*plane/sso_planes;
+    sat.eccentricity = generator_uniform(&state, 0.0001, 0.002);
+    sat.perigee = generator_uniform(&state, 0, 360);
+    sat.mean_anomaly = fmod(360.0*(k/sso_planes)/sats_in_plane + 360 - sat.perigee, 360);
+    sat.mean_motion = mean_motion_from_altitude(altitude);
+    sat.drag = generator_uniform(&state, 0.0001, 0.001);
+    sat_array[i][0] = sat;
+  }
+
+  /* GEO belt. Evenly spaced longitude slots with a little station keeping error. Mean motion of one sidereal day */
+  for(int k = 0; k < geo_count; k++, i++){
+    double slot = 360.0*k/geo_count + generator_uniform(&state, -0.05, 0.05);
+
+    sat.sat_num = i + 1;
+    sat.inclination = generator_uniform(&state, 0, 0.1);
+    sat.raan = generator_uniform(&state, 0, 360);
+    sat.eccentricity = generator_uniform(&state, 0, 0.0005);
+    sat.perigee = generator_uniform(&state, 0, 360);
+    sat.mean_anomaly = fmod(slot + 720 - sat.perigee - sat.raan, 360);
+    sat.mean_motion = 1.00273791 + generator_uniform(&state, -0.0001, 0.0001);
+    sat.drag = 0.0;
+    sat_array[i][0] = sat;
+  }
+
+  /* Debris clouds. Fragments spread around the orbit of a parent object that broke up. One in ten clouds
+     is a highly eccentric transfer orbit (like the Cosmos entries in load_sat_data). There are always at least
+     ten clouds, so about a tenth of the fragments are highly eccentric at any population size. With fewer than
+     ten fragments each is its own cloud and the last one is the transfer orbit */
+  debris_start = i;
+  int number_of_debris = number_of_sats - debris_start;
+  int number_of_clouds = number_of_debris/1000 + 1;
+  if (number_of_clouds < 10) number_of_clouds = 10;
+  if (number_of_clouds > number_of_debris) number_of_clouds = number_of_debris > 0 ? number_of_debris : 1;
+  for(int k = 0; i < number_of_sats; k++, i++){
+    int cloud = k%number_of_clouds;
+    unsigned long long cloud_state = seed ^ (0x2545F4914F6CDD1DULL*(cloud + 1));
+    double parent_inclination = generator_uniform(&cloud_state, 0, 100);
+    double parent_raan = generator_uniform(&cloud_state, 0, 360);
+    double parent_eccentricity;
+    double parent_motion;
+
+    if (cloud%10 == 9 || (number_of_clouds < 10 && cloud == number_of_clouds - 1)){
+      parent_eccentricity = generator_uniform(&cloud_state, 0.6, 0.75);
+      parent_motion = generator_uniform(&cloud_state, 2.0, 2.3);
+    } else {
+      parent_eccentricity = generator_uniform(&cloud_state, 0.0, 0.02);
+      parent_motion = mean_motion_from_altitude(generator_uniform(&cloud_state, 400, 1500));
+    }
+
+    sat.sat_num = i + 1;
+    sat.inclination = parent_inclination + generator_uniform(&state, -1, 1);
+    sat.raan = fmod(parent_raan + generator_uniform(&state, -2, 2) + 360, 360);
+    sat.eccentricity = fabs(parent_eccentricity + generator_uniform(&state, -0.01, 0.01));
+    sat.perigee = generator_uniform(&state, 0, 360);
+    sat.mean_anomaly = generator_uniform(&state, 0, 360);
+    sat.mean_motion = parent_motion*generator_uniform(&state, 0.97, 1.03);
+    sat.drag = generator_uniform(&state, 0.0001, 0.003);
+    if (sat.inclination < 0){
+      // Spread past the equator. The same orbit with a positive inclination has the node and perigee turned 180
+      sat.inclination = -sat.inclination;
+      sat.raan = fmod(sat.raan + 180, 360);
+      sat.perigee = fmod(sat.perigee + 180, 360);
+    }
+    sat_array[i][0] = sat;
+  }
+
+  /* Near-conjunction pairs. Copy a random partner and nudge it by less than the 2% windows used in collision_risk */
+  for(i = 0; i < number_of_sats; i++){
+    if (number_of_sats < 2 || generator_uniform(&state, 0, 1) >= conjunction_fraction) continue;
+
+    int partner = (int)generator_uniform(&state, 0, number_of_sats - 1);
+    if (partner >= i) partner++; // never pick itself
+
+    double phase;
+    double mean_anomaly; // worked out in degrees, a fixed-point mean_anomaly would wrap before it can be checked
+
+    sat = sat_array[partner][0];
+    sat.sat_num = i + 1;
+    sat.mean_motion *= generator_uniform(&state, 0.995, 1.005);
+    phase = (sat.mean_anomaly + sat.perigee)*generator_uniform(&state, 0.995, 1.005);
+    mean_anomaly = phase - sat.perigee;
+    if (mean_anomaly < 0 || mean_anomaly >= 360){
+      // Nudged across the 0/360 wrap, go the other way instead
+      mean_anomaly = sat_array[partner][0].mean_anomaly - (mean_anomaly - sat_array[partner][0].mean_anomaly);
+    }
+    sat.mean_anomaly = mean_anomaly;
+    sat_array[i][0] = sat;
+  }
+
+  return 0;
+}
+
+// Catalog numbers above 99999 use the Alpha-5 scheme (A0000 = 100000, letters I and O skipped), which tops out
+// at Z9999 (TLE_MAX_CATALOG_NUMBER). write_tle_file won't write anything past that
+void tle_catalog_number(int sat_num, char *catalog){
+  const char *alpha5 = "ABCDEFGHJKLMNPQRSTUVWXYZ";
+
+  if (sat_num < 100000){
+    sprintf(catalog, "%05d", sat_num);
+  } else {
+    sprintf(catalog, "%c%04d", alpha5[sat_num/10000 - 10], sat_num%10000);
+  }
+}
+
+int tle_checksum(const char *line){
+  // Sum of the digits, minus signs count as 1, modulo 10. Over the first 68 columns
+  int sum = 0;
+
+  for(int c = 0; c < 68 && line[c] != '\0'; c++){
+    if (line[c] >= '0' && line[c] <= '9'){
+      sum += line[c] - '0';
+    } else if (line[c] == '-'){
+      sum += 1;
+    }
+  }
+  return sum%10;
+}
+
+// Writes the time step 0 elements of every satellite in sat_array as a standard three-line TLE file
+// (name line, line 1, line 2), so generated populations can be reused by other tools
+int write_tle_file(const char *file_name, param_TLE **sat_array, int number_of_sats){
+  FILE *tle_file;
+  char catalog[12]; // 5 characters once checked, room for any int keeps the compiler happy
+  char line[80];
+  param_TLE sat;
+
+  // Catalog numbers would repeat in the file
+  for(int i = 0; i < number_of_sats; i++){
+    if (sat_array[i][0].sat_num < 0 || sat_array[i][0].sat_num > TLE_MAX_CATALOG_NUMBER){
+      printf("Satellite number %d doesn't fit in a TLE catalog number (0 to %d), not writing %s\n", sat_array[i][0].sat_num, TLE_MAX_CATALOG_NUMBER, file_name);
+      return 1;
+    }
+  }
+
+  tle_file = fopen(file_name, "w");
+  if (tle_file == NULL){
+    printf("Could not open %s for writing\n", file_name);
+    return 1;
+  }
+
+  for(int i = 0; i < number_of_sats; i++){
+    sat = sat_array[i][0];
+    tle_catalog_number(sat.sat_num, catalog);
+
+    fprintf(tle_file, "SYNTH %d\n", sat.sat_num);
+
+    // Drag goes in the first derivative of mean motion divided by two field, written as [sign].nnnnnnnn
+    double drag = fabs(sat.drag) < 0.99999999 ? fabs(sat.drag) : 0.99999999;
+    sprintf(line, "1 %sU 26001A   26001.00000000 %c.%08d  00000-0  00000-0 0  999",
+	    catalog, sat.drag < 0 ? '-' : ' ', (int)(drag*100000000 + 0.5));
+    fprintf(tle_file, "%s%d\n", line, tle_checksum(line));
+
+    // Eccentricity has an assumed leading decimal point
+    int eccentricity = (int)(sat.eccentricity*10000000 + 0.5);
+    if (eccentricity > 9999999) eccentricity = 9999999;
+    // Angles in degrees. The casts convert the fixed-point angles (turns_to_degrees) before they go through printf
+    sprintf(line, "2 %s %8.4f %8.4f %07d %8.4f %8.4f %11.8f%5d",
+	    catalog, sat.inclination, sat.raan, eccentricity, (double)sat.perigee, (double)sat.mean_anomaly, sat.mean_motion, 0);
+    fprintf(tle_file, "%s%d\n", line, tle_checksum(line));
+  }
+
+  fclose(tle_file);
+  return 0;
+}
+
+int orbit_class_of(double eccentricity){
+  if (eccentricity < NEAR_CIRCULAR_MAX_ECCENTRICITY){
+    return NEAR_CIRCULAR;
+  } else if (eccentricity < HIGHLY_ECCENTRIC_MIN_ECCENTRICITY){
+    return MODERATELY_ECCENTRIC;
+  } else {
+    return HIGHLY_ECCENTRIC;
+  }
+}
+
+// Lists the satellites of each orbit class next to each other in class_sats, using the eccentricity at
+// time step 0. Keeps catalog order inside each class and leaves sat_array alone, so pair screening is unchanged.
+// Class c is class_sats[class_start[c]] to class_sats[class_start[c+1]-1]
+int partition_by_orbit_class(param_TLE **sat_array, int number_of_sats, int *class_sats, int *class_start){
+  int next_sat[NUMBER_OF_ORBIT_CLASSES];
+
+  for(int c = 0; c <= NUMBER_OF_ORBIT_CLASSES; c++){
+    class_start[c] = 0;
+  }
+  for(int i = 0; i < number_of_sats; i++){
+    class_start[orbit_class_of(sat_array[i][0].eccentricity) + 1] += 1;
+  }
+  for(int c = 0; c < NUMBER_OF_ORBIT_CLASSES; c++){
+    class_start[c+1] += class_start[c];
+    next_sat[c] = class_start[c];
+  }
+
+  for(int i = 0; i < number_of_sats; i++){
+    class_sats[next_sat[orbit_class_of(sat_array[i][0].eccentricity)]++] = i;
+  }
+
+  return 0;
+}
+
+#ifdef FIXED_POINT_ANGLES
+// Fraction of a turn in revolutions as 1/2^32 turns, rounded to the nearest. Whole turns drop out
+unsigned int revolutions_to_turns(double revolutions){
+  double fraction = revolutions - floor(revolutions); // 0 to 1, also for negative revolutions
+
+  // Rounding 1 - 2^-33 or more up to 2^32 gives 0 after the cast, which is the same angle
+  return (unsigned int)(unsigned long long)(fraction*4294967296.0 + 0.5);
+}
+
+unsigned int degrees_to_turns(double degrees){
+  return revolutions_to_turns(degrees/360);
+}
+
+// 0 to 360
+double turns_to_degrees(unsigned int turns){
+  return turns*DEGREES_PER_TURN_UNIT;
+}
+#endif
+
+#ifdef ANALYTIC_SCREENING
+// Brings an angle in degrees into -180 to 180
+#pragma acc routine seq
+double wrap_degrees(double angle){
+  angle = fmod(angle, 360);
+  if (angle > 180) angle -= 360;
+  if (angle <= -180) angle += 360;
+  return angle;
+}
+
+// Real m in [0, m_max] where low < a*m^2 + b*m + c < high. At most two intervals, returned in order in from/to
+#pragma acc routine seq
+int quadratic_band(double a, double b, double c, double low, double high, double m_max, double *from, double *to){
+  int count = 0;
+  double upper[2];
+  double lower[2];
+  bool has_lower = false;
+
+  if (a == 0){
+    // Linear
+    if (b == 0){
+      if (c <= low || c >= high) return 0;
+      from[0] = 0;
+      to[0] = m_max;
+      return 1;
+    }
+    from[0] = (low - c)/b;
+    to[0] = (high - c)/b;
+    if (b < 0){
+      double swap = from[0];
+      from[0] = to[0];
+      to[0] = swap;
+    }
+    count = 1;
+  } else {
+    // Make it open upwards: below high between the two roots of g = high, minus what is below low
+    if (a < 0){
+      double swap = low;
+      a = -a;
+      b = -b;
+      c = -c;
+      low = -high;
+      high = -swap;
+    }
+    double discriminant = b*b - 4*a*(c - high);
+    if (discriminant <= 0) return 0;
+    // Numerically stable roots
+    double q = -0.5*(b + (b < 0 ? -sqrt(discriminant) : sqrt(discriminant)));
+    upper[0] = q/a;
+    upper[1] = q != 0 ? (c - high)/q : -upper[0];
+    if (upper[0] > upper[1]){
+      double swap = upper[0];
+      upper[0] = upper[1];
+      upper[1] = swap;
+    }
+
+    discriminant = b*b - 4*a*(c - low);
+    if (discriminant > 0){
+      q = -0.5*(b + (b < 0 ? -sqrt(discriminant) : sqrt(discriminant)));
+      lower[0] = q/a;
+      lower[1] = q != 0 ? (c - low)/q : -lower[0];
+      if (lower[0] > lower[1]){
+	double swap = lower[0];
+	lower[0] = lower[1];
+	lower[1] = swap;
+      }
+      has_lower = true;
+    }
+
+    if (has_lower){
+      from[0] = upper[0];
+      to[0] = lower[0];
+      from[1] = lower[1];
+      to[1] = upper[1];
+      count = 2;
+    } else {
+      from[0] = upper[0];
+      to[0] = upper[1];
+      count = 1;
+    }
+  }
+
+  // Clip to [0, m_max] and drop what is left empty
+  int kept = 0;
+  for(int k = 0; k < count; k++){
+    double f = from[k] > 0 ? from[k] : 0;
+    double t = to[k] < m_max ? to[k] : m_max;
+    if (f <= t){
+      from[kept] = f;
+      to[kept] = t;
+      kept++;
+    }
+  }
+  return kept;
+}
+
+// Time step intervals in [first_step, last_step) where the mean motion test of collision_risk can pass.
+// Mean motion changes linearly with time (n = n0 - drag*time_step_size*t), so the test only changes where n2 or
+// n1 - 0.98*n2 or n1 - 1.02*n2 cross zero. Intervals are widened by 2 steps for rounding. Returns how many (up to 4)
+#pragma acc routine seq
+int motion_intervals(param_TLE sat1, param_TLE sat2, int first_step, int last_step, int time_step_size, int *interval_first, int *interval_last){
+  double rate1 = sat1.drag*time_step_size; // mean motion lost per time step
+  double rate2 = sat2.drag*time_step_size;
+  double breaks[5];
+  int number_of_breaks = 0;
+  int count = 0;
+
+  breaks[number_of_breaks++] = first_step;
+  // Zeros of n2, n1 - 0.98*n2 and n1 - 1.02*n2
+  double slopes[3] = {rate2, rate1 - 0.98*rate2, rate1 - 1.02*rate2};
+  double values[3] = {sat2.mean_motion, sat1.mean_motion - 0.98*sat2.mean_motion, sat1.mean_motion - 1.02*sat2.mean_motion};
+  for(int k = 0; k < 3; k++){
+    if (slopes[k] != 0){
+      double zero = values[k]/slopes[k];
+      if (zero > first_step && zero < last_step - 1){
+	// Insertion sort, there are at most 3
+	int position = number_of_breaks;
+	while (position > 1 && breaks[position-1] > zero){
+	  breaks[position] = breaks[position-1];
+	  position--;
+	}
+	breaks[position] = zero;
+	number_of_breaks++;
+      }
+    }
+  }
+  breaks[number_of_breaks] = last_step - 1;
+
+  for(int k = 0; k < number_of_breaks; k++){
+    // The test is the same all the way between two breaks, check it half way
+    double middle = 0.5*(breaks[k] + breaks[k+1]);
+    double motion1 = sat1.mean_motion - rate1*middle;
+    double motion2 = sat2.mean_motion - rate2*middle;
+
+    if (motion1/motion2 > 0.98 && motion1/motion2 < 1.02){
+      int from = (int)floor(breaks[k]) - 2;
+      int to = (int)ceil(breaks[k+1]) + 2;
+      if (from < first_step) from = first_step;
+      if (to > last_step - 1) to = last_step - 1;
+      if (count > 0 && from <= interval_last[count-1] + 1){
+	interval_last[count-1] = to;
+      } else {
+	interval_first[count] = from;
+	interval_last[count] = to;
+	count++;
+      }
+    }
+  }
+  return count;
+}
+
+// Counts the time steps in [first_step, last_step) where collision_risk(sat1, sat2) is true, without visiting
+// every step. Relative to sat2, sat1's mean anomaly + perigee is a quadratic in the time step t, modulo 360:
+//   phase(t) = c0 + c1*t + c2*t^2, from the mean motions and (through the drag term) their linear change.
+// collision_risk needs |phase| < 2% of sat2's mean anomaly + perigee, so only steps with phase (mod 360) inside
+// that window are candidates. Taking every q-th step turns a fast phase into a slow one, and the candidates of
+// each such subsequence are solved for directly with quadratic_band. Segments where that would not save work
+// are scanned. Every candidate is checked with collision_risk on the propagated states, so the count is exactly
+// what checking every step gives. checked_steps is increased by how many steps were checked
+#pragma acc routine seq
+int analytic_pair_risks(param_TLE **sat_array, int sat1, int sat2, int first_step, int last_step, int time_step_size, long long *checked_steps){
+  param_TLE start1 = sat_array[sat1][0];
+  param_TLE start2 = sat_array[sat2][0];
+  param_TLE *row1 = sat_array[sat1];
+  param_TLE *row2 = sat_array[sat2];
+  double dt = time_step_size;
+  int interval_first[4];
+  int interval_last[4];
+  int number_of_intervals;
+  int risks = 0;
+  double from[2];
+  double to[2];
+
+  number_of_intervals = motion_intervals(start1, start2, first_step, last_step, time_step_size, interval_first, interval_last);
+  if (number_of_intervals == 0) return 0;
+
+  // mean_anomaly(t) = mean_anomaly(0) + 360*dt*(n0*t - drag*dt*t*(t-1)/2) modulo 360. t and t^2 are whole
+  // numbers so c1 and c2 can be taken modulo 360, and t*(t-1) is even so 180 can move between them
+  double c0 = wrap_degrees(start1.mean_anomaly + start1.perigee - start2.mean_anomaly - start2.perigee);
+  double c1 = wrap_degrees(360*dt*(start1.mean_motion - start2.mean_motion) + 180*dt*dt*(start1.drag - start2.drag));
+  double c2 = wrap_degrees(-180*dt*dt*(start1.drag - start2.drag));
+  if (c2 > 90){
+    c2 -= 180;
+    c1 += 180;
+  } else if (c2 < -90){
+    c2 += 180;
+    c1 -= 180;
+  }
+
+  // Half width of the phase window: |X - Y| < 0.02*|Y| with |Y| < |perigee| + 360
+  double scale = (double)last_step/100000;
+  double window = 0.02*(fabs(start2.perigee) + 360) + ANALYTIC_PHASE_MARGIN*(1 + scale*scale);
+
+  // Segments short enough that the change in phase rate over one stays small
+  int segment_steps = c2 != 0 ? (int)sqrt(360/fabs(c2)) : last_step;
+  if (segment_steps < 1) segment_steps = 1;
+
+  for(int interval = 0; interval < number_of_intervals; interval++){
+    int t = interval_first[interval];
+
+    while (t <= interval_last[interval]){
+      int steps = interval_last[interval] - t + 1 < segment_steps ? interval_last[interval] - t + 1 : segment_steps;
+      double rate = c1 + c2*(2.0*t + 1); // phase change from step t to t+1
+      int stride = 1;
+      double work = 2.0*steps;
+
+      // Pick the stride that needs the fewest windows solved
+      for(int q = 1; q <= ANALYTIC_MAX_STRIDE && q <= steps; q++){
+	double q_work = (fabs(wrap_degrees(q*rate))*steps + q*fabs(c2)*steps*steps)/360 + 2*q;
+	if (q_work < work){
+	  work = q_work;
+	  stride = q;
+	}
+      }
+
+      if (ANALYTIC_ROOT_COST*work >= steps){
+	// Not worth it here, check every step
+	for(int step = t; step < t + steps; step++){
+	  risks += collision_risk(row1[step], row2[step]);
+	}
+	*checked_steps += steps;
+      } else {
+	for(int offset = 0; offset < stride && offset < steps; offset++){
+	  int t0 = t + offset;
+	  int m_max = (t + steps - 1 - t0)/stride;
+	  // phase(t0 + m*stride) = phase(t0) + m*increment + a*(m^2 - m), modulo 360
+	  double phase0 = wrap_degrees(c0 + wrap_degrees(c1*t0) + wrap_degrees(c2*((double)t0*t0)));
+	  double a = c2*stride*stride;
+	  double increment = wrap_degrees(stride*wrap_degrees(c1 + 2*c2*t0) + a);
+	  double b = increment - a;
+
+	  // Range of the unwrapped phase over this subsequence, to know which multiples of 360 it passes
+	  double phase_min = phase0 < phase0 + (a*m_max + b)*m_max ? phase0 : phase0 + (a*m_max + b)*m_max;
+	  double phase_max = phase0 > phase0 + (a*m_max + b)*m_max ? phase0 : phase0 + (a*m_max + b)*m_max;
+	  if (a != 0){
+	    double vertex = -b/(2*a);
+	    if (vertex > 0 && vertex < m_max){
+	      double phase_vertex = phase0 + (a*vertex + b)*vertex;
+	      if (phase_vertex < phase_min) phase_min = phase_vertex;
+	      if (phase_vertex > phase_max) phase_max = phase_vertex;
+	    }
+	  }
+
+	  int last_m = -1;
+	  for(int turn = (int)ceil((phase_min - window)/360); turn <= (int)floor((phase_max + window)/360); turn++){
+	    int bands = quadratic_band(a, b, phase0, 360.0*turn - window, 360.0*turn + window, m_max, from, to);
+	    for(int band = 0; band < bands; band++){
+	      int m_first = (int)ceil(from[band] - 1e-7);
+	      int m_last = (int)floor(to[band] + 1e-7);
+	      // The two bands of one turn can touch after rounding, don't check a step twice
+	      if (band == 1 && m_first <= last_m) m_first = last_m + 1;
+	      if (m_last > m_max) m_last = m_max;
+	      for(int m = m_first; m <= m_last; m++){
+		int step = t0 + m*stride;
+		risks += collision_risk(row1[step], row2[step]);
+		*checked_steps += 1;
+	      }
+	      last_m = m_last;
+	    }
+	  }
+	}
+      }
+      t += steps;
+    }
+  }
+  return risks;
+}
+#endif
+
+#if defined(NUMA_WORKERS) || defined(PIPELINED)
+double wall_seconds(){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec*1e-9;
+}
+#endif
+
+#ifdef NUMA_WORKERS
+// Propagates the satellites at positions first to last-1 of class_sats (all of one orbit class) through time steps
+// first_step to last_step-1. Step 0 holds the initial conditions so it is never written
+template <int ORBIT_CLASS>
+void propagate_sat_block(param_TLE **sat_array, const int *class_sats, int first, int last, int first_step, int last_step, int time_step_size){
+  if (first_step < 1) first_step = 1;
+
+  for(int k = first; k < last; k++){
+    param_TLE *row = sat_array[class_sats[k]];
+    for(int t = first_step; t < last_step; t++){
+      propagate_sat_step<ORBIT_CLASS>(row[t-1], row[t], time_step_size);
+    }
+  }
+}
+
+// Parses a sysfs list like "0-15,32-47" into values. Returns how many there were
+int numa_parse_list(const char *list, int *values, int max_values){
+  int count = 0;
+  int first;
+  int last;
+  int used;
+
+  while (sscanf(list, "%d%n", &first, &used) == 1){
+    list += used;
+    last = first;
+    if (*list == '-' && sscanf(list + 1, "%d%n", &last, &used) == 1){
+      list += used + 1;
+    }
+    for(int v = first; v <= last && count < max_values; v++){
+      values[count++] = v;
+    }
+    if (*list != ',') break;
+    list++;
+  }
+  return count;
+}
+
+// Finds the NUMA nodes and the cpus on each one that this process is allowed to run on (batch systems often
+// only give us a few cores). Nodes with no usable cpus, like memory-only nodes, are left out.
+// Without /sys/devices/system/node everything is treated as one node
+int numa_topology(numa_node_info *nodes, int max_nodes){
+  int number_of_nodes = 0;
+  int node_ids[NUMA_MAX_NODES];
+  int number_of_ids;
+  int node_cpus[NUMA_MAX_CPUS];
+  int number_of_cpus;
+  char path[64];
+  char list[4096];
+  FILE *list_file;
+  cpu_set_t allowed;
+
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+
+  number_of_ids = 0;
+  list_file = fopen("/sys/devices/system/node/online", "r");
+  if (list_file != NULL){
+    if (fgets(list, sizeof(list), list_file) != NULL){
+      number_of_ids = numa_parse_list(list, node_ids, max_nodes < NUMA_MAX_NODES ? max_nodes : NUMA_MAX_NODES);
+    }
+    fclose(list_file);
+  }
+
+  for(int n = 0; n < number_of_ids; n++){
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node_ids[n]);
+    list_file = fopen(path, "r");
+    if (list_file == NULL) continue;
+    number_of_cpus = 0;
+    if (fgets(list, sizeof(list), list_file) != NULL){
+      number_of_cpus = numa_parse_list(list, node_cpus, NUMA_MAX_CPUS);
+    }
+    fclose(list_file);
+
+    memset(&nodes[number_of_nodes], 0, sizeof(numa_node_info));
+    nodes[number_of_nodes].node = node_ids[n];
+    for(int c = 0; c < number_of_cpus; c++){
+      if (node_cpus[c] < CPU_SETSIZE && CPU_ISSET(node_cpus[c], &allowed)){
+	nodes[number_of_nodes].cpus[nodes[number_of_nodes].number_of_cpus++] = node_cpus[c];
+      }
+    }
+    if (nodes[number_of_nodes].number_of_cpus > 0) number_of_nodes++;
+  }
+
+  if (number_of_nodes == 0){
+    memset(&nodes[0], 0, sizeof(numa_node_info));
+    for(int c = 0; c < CPU_SETSIZE && nodes[0].number_of_cpus < NUMA_MAX_CPUS; c++){
+      if (CPU_ISSET(c, &allowed)) nodes[0].cpus[nodes[0].number_of_cpus++] = c;
+    }
+    if (nodes[0].number_of_cpus == 0) nodes[0].cpus[nodes[0].number_of_cpus++] = 0;
+    number_of_nodes = 1;
+  }
+
+  return number_of_nodes;
+}
+
+// Splits the time steps between the nodes in proportion to their cpus. Blocks start on a page boundary of the
+// (page aligned) rows so every page of a row belongs to exactly one node. Rows shorter than a page are packed
+// together by numa_alloc_sat_array, so there the blocks just follow the cpus
+void numa_assign_time_blocks(numa_node_info *nodes, int number_of_nodes, int number_of_t_steps){
+  int total_cpus = 0;
+  int cpus_so_far = 0;
+  int boundary;
+  int block_steps = number_of_t_steps*sizeof(param_TLE) < NUMA_PAGE_BYTES ? 1 : NUMA_PAGE_STEPS; // blocks are a multiple of this
+
+  for(int n = 0; n < number_of_nodes; n++){
+    total_cpus += nodes[n].number_of_cpus;
+  }
+
+  nodes[0].first_step = 0;
+  for(int n = 0; n < number_of_nodes; n++){
+    cpus_so_far += nodes[n].number_of_cpus;
+    boundary = (int)((double)number_of_t_steps*cpus_so_far/total_cpus/block_steps + 0.5)*block_steps;
+    if (boundary > number_of_t_steps || n == number_of_nodes - 1) boundary = number_of_t_steps;
+    if (boundary < nodes[n].first_step) boundary = nodes[n].first_step;
+    nodes[n].last_step = boundary;
+    if (n + 1 < number_of_nodes) nodes[n+1].first_step = boundary;
+  }
+}
+
+// Allocates page aligned rows without touching them, then has each node's workers zero their own time blocks
+// so the pages end up in that node's memory. A row shorter than a page can't be split between nodes, so those
+// are allocated as they are instead of padding every row out to a page. Returns NULL if a row can't be allocated
+param_TLE **numa_alloc_sat_array(numa_node_info *nodes, int number_of_nodes, int number_of_sats, int number_of_t_steps){
+  param_TLE **sat_array = new param_TLE*[number_of_sats];
+  size_t row_bytes = number_of_t_steps*sizeof(param_TLE);
+  bool page_rows = row_bytes >= NUMA_PAGE_BYTES;
+  void *row;
+  numa_job job;
+
+  if (page_rows) row_bytes = (row_bytes + NUMA_PAGE_BYTES - 1)/NUMA_PAGE_BYTES*NUMA_PAGE_BYTES;
+
+  for(int i = 0; i < number_of_sats; i++){
+    if (page_rows){
+      if (posix_memalign(&row, NUMA_PAGE_BYTES, row_bytes) != 0) row = NULL;
+    } else {
+      row = malloc(row_bytes);
+    }
+    if (row == NULL){
+      printf("Could not allocate %d time steps for satellite %d\n", number_of_t_steps, i);
+      numa_free_sat_array(sat_array, i);
+      return NULL;
+    }
+    sat_array[i] = (param_TLE *)row;
+  }
+
+  memset(&job, 0, sizeof(numa_job));
+  job.job_type = NUMA_FIRST_TOUCH;
+  job.nodes = nodes;
+  job.number_of_nodes = number_of_nodes;
+  job.sat_array = sat_array;
+  job.number_of_sats = number_of_sats;
+  job.number_of_t_steps = number_of_t_steps;
+  numa_run(&job);
+
+  return sat_array;
+}
+
+void numa_free_sat_array(param_TLE **sat_array, int number_of_sats){
+  for(int i = 0; i < number_of_sats; i++){
+    free(sat_array[i]);
+  }
+  delete[] sat_array;
+}
+
+void *numa_worker_main(void *arg){
+  numa_worker *worker = (numa_worker *)arg;
+  numa_job *job = worker->job;
+  numa_node_info *node = &job->nodes[worker->node];
+  param_TLE **sat_array = job->sat_array;
+  int number_of_sats = job->number_of_sats;
+  int steps = node->last_step - node->first_step;
+  double start = wall_seconds();
+
+  worker->risks = 0;
+  worker->bytes = 0;
+
+  if (job->job_type == NUMA_FIRST_TOUCH){
+    // Rows are shared out between the node's workers, each zeroes the node's time block of its rows
+    for(int i = worker->node_rank; i < number_of_sats; i += worker->node_workers){
+      memset(&sat_array[i][node->first_step], 0, steps*sizeof(param_TLE));
+      worker->bytes += steps*sizeof(param_TLE);
+    }
+  } else if (job->job_type == NUMA_PROPAGATE){
+    // Wavefront over chunks of satellites. A node propagates its time block of a chunk once the node before it
+    // has finished that chunk (chunk_block[c] reaches this node), so every node only writes its own pages and
+    // all nodes are busy after the first few chunks
+    for(int c = worker->node_rank; c < job->number_of_chunks; c += worker->node_workers){
+      int first = c*NUMA_CHUNK_SATS;
+      int last = first + NUMA_CHUNK_SATS < number_of_sats ? first + NUMA_CHUNK_SATS : number_of_sats;
+
+      while (__atomic_load_n(&job->chunk_block[c], __ATOMIC_ACQUIRE) < worker->node){
+	sched_yield();
+      }
+
+#ifdef GENERIC_PROPAGATION
+      propagate_sat_block<HIGHLY_ECCENTRIC>(sat_array, job->class_sats, first, last, node->first_step, node->last_step, job->time_step_size);
+#else
+      // The chunk is a range of class_sats so it can cross from one orbit class into the next
+      for(int orbit = 0; orbit < NUMBER_OF_ORBIT_CLASSES; orbit++){
+	int class_first = first > job->class_start[orbit] ? first : job->class_start[orbit];
+	int class_last = last < job->class_start[orbit+1] ? last : job->class_start[orbit+1];
+	if (class_first >= class_last) continue;
+
+	if (orbit == NEAR_CIRCULAR){
+	  propagate_sat_block<NEAR_CIRCULAR>(sat_array, job->class_sats, class_first, class_last, node->first_step, node->last_step, job->time_step_size);
+	} else if (orbit == MODERATELY_ECCENTRIC){
+	  propagate_sat_block<MODERATELY_ECCENTRIC>(sat_array, job->class_sats, class_first, class_last, node->first_step, node->last_step, job->time_step_size);
+	} else {
+	  propagate_sat_block<HIGHLY_ECCENTRIC>(sat_array, job->class_sats, class_first, class_last, node->first_step, node->last_step, job->time_step_size);
+	}
+      }
+#endif
+      // Read one time step and write the next
+      worker->bytes += 2.0*(last - first)*steps*sizeof(param_TLE);
+
+      __atomic_store_n(&job->chunk_block[c], worker->node + 1, __ATOMIC_RELEASE);
+    }
+  } else if (job->job_type == NUMA_SCREEN){
+    // Only this node's time steps, shared out between its workers. Start at 1 as time step 0 is the initial conditions
+    int first_step = node->first_step > 1 ? node->first_step : 1;
+
+#ifdef ANALYTIC_SCREENING
+    // Pairs shared out between the node's workers, each solving for its risk steps inside this node's time steps
+    long long checked_steps = 0;
+    for(int sat_loops = worker->node_rank; sat_loops < (number_of_sats-1); sat_loops += worker->node_workers){
+      for(int compare_loops = sat_loops+1; compare_loops < number_of_sats; compare_loops++){
+	if (first_step < node->last_step){
+	  worker->risks += analytic_pair_risks(sat_array, sat_loops, compare_loops, first_step, node->last_step, job->time_step_size, &checked_steps);
+	}
+      }
+    }
+    worker->bytes += 2.0*checked_steps*sizeof(param_TLE);
+#else
+    for(int t = first_step + worker->node_rank; t < node->last_step; t += worker->node_workers){
+      for(int sat_loops = 0; sat_loops < (number_of_sats-1); sat_loops++){
+	for(int compare_loops = sat_loops+1; compare_loops < number_of_sats; compare_loops++){
+	  if (collision_risk(sat_array[sat_loops][t], sat_array[compare_loops][t])){
+	    worker->risks += 1;
+	  }
+	}
+      }
+      // Every satellite's TLE at this time step is read from the node's memory once, the pairs reuse it from cache
+      worker->bytes += (double)number_of_sats*sizeof(param_TLE);
+    }
+#endif
+  }
+
+  worker->seconds = wall_seconds() - start;
+  return NULL;
+}
+
+// Starts the workers for a job, each pinned to one cpu of its node, and waits for them to finish.
+// Per node time (slowest worker) and bytes go into the run summary. Returns the collision risks found
+long long numa_run(numa_job *job){
+  int number_of_workers = 0;
+  int w = 0;
+  long long risks = 0;
+  numa_worker *workers;
+  pthread_attr_t attr;
+  cpu_set_t cpu;
+
+  for(int n = 0; n < job->number_of_nodes; n++){
+    number_of_workers += NUMA_THREADS_PER_NODE > 0 ? NUMA_THREADS_PER_NODE : job->nodes[n].number_of_cpus;
+  }
+  workers = new numa_worker[number_of_workers];
+
+  job->chunk_block = NULL;
+  if (job->job_type == NUMA_PROPAGATE){
+    job->number_of_chunks = (job->number_of_sats + NUMA_CHUNK_SATS - 1)/NUMA_CHUNK_SATS;
+    job->chunk_block = new int[job->number_of_chunks];
+    for(int c = 0; c < job->number_of_chunks; c++){
+      job->chunk_block[c] = 0;
+    }
+  }
+
+  for(int n = 0; n < job->number_of_nodes; n++){
+    int node_workers = NUMA_THREADS_PER_NODE > 0 ? NUMA_THREADS_PER_NODE : job->nodes[n].number_of_cpus;
+
+    for(int r = 0; r < node_workers; r++, w++){
+      workers[w].job = job;
+      workers[w].node = n;
+      workers[w].node_rank = r;
+      workers[w].node_workers = node_workers;
+
+      CPU_ZERO(&cpu);
+      CPU_SET(job->nodes[n].cpus[r % job->nodes[n].number_of_cpus], &cpu);
+      pthread_attr_init(&attr);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu);
+      if (pthread_create(&workers[w].thread, &attr, numa_worker_main, &workers[w]) != 0){
+	// Not allowed to pin here, run it unpinned rather than not at all
+	pthread_create(&workers[w].thread, NULL, numa_worker_main, &workers[w]);
+      }
+      pthread_attr_destroy(&attr);
+    }
+  }
+
+  for(w = 0; w < number_of_workers; w++){
+    pthread_join(workers[w].thread, NULL);
+  }
+
+  for(w = 0; w < number_of_workers; w++){
+    numa_node_info *node = &job->nodes[workers[w].node];
+
+    risks += workers[w].risks;
+    if (job->job_type == NUMA_FIRST_TOUCH){
+      node->touched_bytes += workers[w].bytes;
+    } else if (job->job_type == NUMA_PROPAGATE){
+      node->propagate_bytes += workers[w].bytes;
+      if (workers[w].seconds > node->propagate_seconds) node->propagate_seconds = workers[w].seconds;
+    } else {
+      node->screen_bytes += workers[w].bytes;
+      if (workers[w].seconds > node->screen_seconds) node->screen_seconds = workers[w].seconds;
+    }
+  }
+
+  delete[] job->chunk_block;
+  job->chunk_block = NULL;
+  delete[] workers;
+  return risks;
+}
+
+void numa_report(numa_node_info *nodes, int number_of_nodes){
+  for(int n = 0; n < number_of_nodes; n++){
+    printf("NUMA node %d: %d cpus | time steps %d-%d | %.1f MB local | propagate %.3f s %.2f GB/s | screen %.3f s %.2f GB/s\n",
+	   nodes[n].node, nodes[n].number_of_cpus, nodes[n].first_step, nodes[n].last_step - 1, nodes[n].touched_bytes/1e6,
+	   nodes[n].propagate_seconds, nodes[n].propagate_seconds > 0 ? nodes[n].propagate_bytes/nodes[n].propagate_seconds/1e9 : 0.0,
+	   nodes[n].screen_seconds, nodes[n].screen_seconds > 0 ? nodes[n].screen_bytes/nodes[n].screen_seconds/1e9 : 0.0);
+  }
+}
+#endif
+
+#ifdef PIPELINED
+// Propagates the satellites at positions first to last-1 of class_sats (all of one orbit class) by one time step,
+// from the current time step's states to the next one's. Both are a full time step of the pipeline's state buffer
+template <int ORBIT_CLASS>
+void propagate_sats_one_step(const param_TLE *current, param_TLE *next, const int *class_sats, int first, int last, int time_step_size){
+  for(int k = first; k < last; k++){
+    int sat = class_sats[k];
+    propagate_sat_step<ORBIT_CLASS>(current[sat], next[sat], time_step_size);
+  }
+}
+
+// Fills block k's time steps in slot k%2, carrying on from the last time step of block k-1 in the other slot
+void pipeline_propagate_block(pipeline *pipe, int block){
+  int number_of_sats = pipe->number_of_sats;
+  int first_step = block*PIPELINE_BLOCK_STEPS;
+  int last_step = first_step + PIPELINE_BLOCK_STEPS < pipe->number_of_t_steps ? first_step + PIPELINE_BLOCK_STEPS : pipe->number_of_t_steps;
+  param_TLE *states = pipe->state[block%2];
+  const int *class_start = pipe->class_start;
+
+  for(int t = first_step; t < last_step; t++){
+    param_TLE *next = &states[(t - first_step)*number_of_sats];
+    const param_TLE *current;
+
+    if (t == 0){
+      // The first time step is filled with the initial conditions
+      for(int sat = 0; sat < number_of_sats; sat++){
+	next[sat] = pipe->initial[sat][0];
+      }
+      continue;
+    }
+
+    if (t == first_step){
+      current = &pipe->state[(block+1)%2][(PIPELINE_BLOCK_STEPS - 1)*number_of_sats];
+    } else {
+      current = next - number_of_sats;
+    }
+
+#ifdef GENERIC_PROPAGATION
+    propagate_sats_one_step<HIGHLY_ECCENTRIC>(current, next, pipe->class_sats, 0, number_of_sats, pipe->time_step_size);
+#else
+    propagate_sats_one_step<NEAR_CIRCULAR>(current, next, pipe->class_sats, class_start[NEAR_CIRCULAR], class_start[NEAR_CIRCULAR+1], pipe->time_step_size);
+    propagate_sats_one_step<MODERATELY_ECCENTRIC>(current, next, pipe->class_sats, class_start[MODERATELY_ECCENTRIC], class_start[MODERATELY_ECCENTRIC+1], pipe->time_step_size);
+    propagate_sats_one_step<HIGHLY_ECCENTRIC>(current, next, pipe->class_sats, class_start[HIGHLY_ECCENTRIC], class_start[HIGHLY_ECCENTRIC+1], pipe->time_step_size);
+#endif
+  }
+}
+
+// Whether the next list to write is ready: its screening task has finished, or filled it and is waiting.
+// Called with pipe->lock held
+bool pipeline_write_ready(pipeline *pipe){
+  if (pipe->writing || pipe->blocks_written == pipe->number_of_blocks) return false;
+
+  event_list *events = &pipe->events[pipe->blocks_written%2][pipe->write_task];
+  return events->done || events->full;
+}
+
+// Writes out and empties one screening task's event list. Only called by the thread that set pipe->writing,
+// without the lock. Returns how many there were
+long long pipeline_write_list(pipeline *pipe, int block, int task){
+  event_list *events = &pipe->events[block%2][task];
+  long long risks = events->count;
+
+  if (pipe->events_file != NULL){
+    for(int e = 0; e < events->count; e++){
+      fprintf(pipe->events_file, "%d %d %d\n", events->events[e].time_step, events->events[e].sat1, events->events[e].sat2);
+    }
+  }
+  events->count = 0;
+  return risks;
+}
+
+// After a write, with pipe->lock held. A finished list moves the writer on to the next one, a full one lets its
+// screening task carry on
+void pipeline_write_done(pipeline *pipe, long long risks){
+  event_list *events = &pipe->events[pipe->blocks_written%2][pipe->write_task];
+
+  pipe->risks += risks;
+  pipe->writing = false;
+  if (events->done){
+    events->done = false;
+    pipe->write_task += 1;
+    if (pipe->write_task == PIPELINE_SCREEN_TASKS){
+      pipe->write_task = 0;
+      pipe->blocks_written += 1;
+    }
+  } else {
+    events->full = false;
+  }
+  pthread_cond_broadcast(&pipe->changed);
+}
+
+// Called by a screening task whose list is full. Waits for the list to be written out (backpressure), doing the
+// writing itself whenever no other thread is, so the pipeline keeps moving even if every thread ends up in here
+void pipeline_wait_for_writer(pipeline *pipe, event_list *events){
+  pthread_mutex_lock(&pipe->lock);
+  events->full = true;
+  pthread_cond_broadcast(&pipe->changed);
+  while (events->full){
+    if (pipeline_write_ready(pipe)){
+      int block = pipe->blocks_written;
+      int task = pipe->write_task;
+      double start = wall_seconds();
+
+      pipe->writing = true;
+      pthread_mutex_unlock(&pipe->lock);
+      long long risks = pipeline_write_list(pipe, block, task);
+      pthread_mutex_lock(&pipe->lock);
+      pipe->stage_seconds[PIPELINE_WRITE] += wall_seconds() - start;
+      pipeline_write_done(pipe, risks);
+    } else {
+      pthread_cond_wait(&pipe->changed, &pipe->lock);
+    }
+  }
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+// Screening task: one contiguous share of block k's time steps, so writing the tasks' lists in order keeps
+// the events in time step order
+void pipeline_screen_block(pipeline *pipe, int block, int task){
+  int number_of_sats = pipe->number_of_sats;
+  int block_first = block*PIPELINE_BLOCK_STEPS;
+  int block_last = block_first + PIPELINE_BLOCK_STEPS < pipe->number_of_t_steps ? block_first + PIPELINE_BLOCK_STEPS : pipe->number_of_t_steps;
+  int task_steps = (block_last - block_first + PIPELINE_SCREEN_TASKS - 1)/PIPELINE_SCREEN_TASKS;
+  int first_step = block_first + task*task_steps;
+  int last_step = first_step + task_steps < block_last ? first_step + task_steps : block_last;
+  event_list *events = &pipe->events[block%2][task];
+
+  // Start at 1 as the first time step (0) is filled with the initial conditions
+  if (first_step < 1) first_step = 1;
+
+  for(int t = first_step; t < last_step; t++){
+    const param_TLE *sats = &pipe->state[block%2][(t - block_first)*number_of_sats];
+
+    // -1 as last satellite in list will already be checked against everything else
+    for(int sat_loops = 0; sat_loops < (number_of_sats-1); sat_loops++){
+      for(int compare_loops = sat_loops+1; compare_loops < number_of_sats; compare_loops++){
+	if (collision_risk(sats[sat_loops], sats[compare_loops])){
+	  if (events->count == PIPELINE_EVENT_CAPACITY) pipeline_wait_for_writer(pipe, events);
+	  events->events[events->count].time_step = t;
+	  events->events[events->count].sat1 = sats[sat_loops].sat_num;
+	  events->events[events->count].sat2 = sats[compare_loops].sat_num;
+	  events->count += 1;
+	}
+      }
+    }
+  }
+}
+
+// Picks the next task that is ready, waiting until one is. Called with pipe->lock held.
+// Block k's state slot is free once block k-2 is screened, and its event slot once block k-2 is written.
+// Writing comes first and propagation second so buffers are freed and refilled before more screening is started.
+// A write task writes one screening task's list
+int pipeline_next_task(pipeline *pipe, int *block, int *task){
+  while (pipe->blocks_written < pipe->number_of_blocks){
+    int next_write = pipe->blocks_written;
+    int next_propagate = pipe->blocks_propagated;
+    int next_screen = pipe->next_screen;
+
+    if (pipeline_write_ready(pipe)){
+      pipe->writing = true;
+      *block = next_write;
+      *task = pipe->write_task;
+      return PIPELINE_WRITE;
+    }
+
+    if (!pipe->propagating && next_propagate < pipe->number_of_blocks
+	&& (next_propagate < 2 || pipe->screen_tasks_done[next_propagate-2] == PIPELINE_SCREEN_TASKS)){
+      pipe->propagating = true;
+      *block = next_propagate;
+      return PIPELINE_PROPAGATE;
+    }
+
+    if (next_screen < next_propagate && next_screen - 2 < next_write){
+      *block = next_screen;
+      *task = pipe->screen_tasks_started;
+      pipe->screen_tasks_started += 1;
+      if (pipe->screen_tasks_started == PIPELINE_SCREEN_TASKS){
+	pipe->next_screen += 1;
+	pipe->screen_tasks_started = 0;
+      }
+      return PIPELINE_SCREEN;
+    }
+
+    pthread_cond_wait(&pipe->changed, &pipe->lock);
+  }
+  return PIPELINE_DONE;
+}
+
+void *pipeline_worker_main(void *arg){
+  pipeline *pipe = (pipeline *)arg;
+  int task_type;
+  int block;
+  int task = 0;
+  long long risks = 0;
+  double start;
+
+  pthread_mutex_lock(&pipe->lock);
+  while ((task_type = pipeline_next_task(pipe, &block, &task)) != PIPELINE_DONE){
+    pthread_mutex_unlock(&pipe->lock);
+
+    start = wall_seconds();
+    if (task_type == PIPELINE_PROPAGATE){
+      pipeline_propagate_block(pipe, block);
+    } else if (task_type == PIPELINE_SCREEN){
+      pipeline_screen_block(pipe, block, task);
+    } else {
+      risks = pipeline_write_list(pipe, block, task);
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    pipe->stage_seconds[task_type] += wall_seconds() - start;
+    if (task_type == PIPELINE_PROPAGATE){
+      pipe->blocks_propagated += 1;
+      pipe->propagating = false;
+    } else if (task_type == PIPELINE_SCREEN){
+      pipe->screen_tasks_done[block] += 1;
+      pipe->events[block%2][task].done = true;
+    } else {
+      pipeline_write_done(pipe, risks);
+    }
+    pthread_cond_broadcast(&pipe->changed);
+  }
+  pthread_mutex_unlock(&pipe->lock);
+
+  return NULL;
+}
+
+// Propagates and screens number_of_t_steps time steps from the initial conditions in initial[sat][0],
+// writing every collision risk to PIPELINE_EVENTS_FILE as "time_step sat_num sat_num". Returns how many there were
+long long pipeline_run(param_TLE **initial, int number_of_sats, int number_of_t_steps, int time_step_size, const int *class_sats, const int *class_start){
+  pipeline pipe;
+  pthread_t threads[PIPELINE_THREADS];
+  double start = wall_seconds();
+
+  pipe.initial = initial;
+  pipe.number_of_sats = number_of_sats;
+  pipe.number_of_t_steps = number_of_t_steps;
+  pipe.time_step_size = time_step_size;
+  pipe.class_sats = class_sats;
+  pipe.class_start = class_start;
+  pipe.number_of_blocks = (number_of_t_steps + PIPELINE_BLOCK_STEPS - 1)/PIPELINE_BLOCK_STEPS;
+  // A run shorter than a block only needs its own time steps
+  int slot_steps = number_of_t_steps < PIPELINE_BLOCK_STEPS ? number_of_t_steps : PIPELINE_BLOCK_STEPS;
+
+  for(int slot = 0; slot < 2; slot++){
+    pipe.state[slot] = new param_TLE[(size_t)slot_steps*number_of_sats];
+    for(int task = 0; task < PIPELINE_SCREEN_TASKS; task++){
+      pipe.events[slot][task].events = new collision_event[PIPELINE_EVENT_CAPACITY];
+      pipe.events[slot][task].count = 0;
+      pipe.events[slot][task].full = false;
+      pipe.events[slot][task].done = false;
+    }
+  }
+
+  pipe.events_file = fopen(PIPELINE_EVENTS_FILE, "w");
+  if (pipe.events_file == NULL){
+    printf("Could not open %s for writing, collision risks are only counted\n", PIPELINE_EVENTS_FILE);
+  }
+
+  pthread_mutex_init(&pipe.lock, NULL);
+  pthread_cond_init(&pipe.changed, NULL);
+  pipe.blocks_propagated = 0;
+  pipe.propagating = false;
+  pipe.next_screen = 0;
+  pipe.screen_tasks_started = 0;
+  pipe.screen_tasks_done = new int[pipe.number_of_blocks];
+  for(int block = 0; block < pipe.number_of_blocks; block++){
+    pipe.screen_tasks_done[block] = 0;
+  }
+  pipe.blocks_written = 0;
+  pipe.write_task = 0;
+  pipe.writing = false;
+  pipe.risks = 0;
+  pipe.stage_seconds[PIPELINE_PROPAGATE] = 0;
+  pipe.stage_seconds[PIPELINE_SCREEN] = 0;
+  pipe.stage_seconds[PIPELINE_WRITE] = 0;
+
+  for(int w = 0; w < PIPELINE_THREADS; w++){
+    pthread_create(&threads[w], NULL, pipeline_worker_main, &pipe);
+  }
+  for(int w = 0; w < PIPELINE_THREADS; w++){
+    pthread_join(threads[w], NULL);
+  }
+
+  printf("Pipeline: %d blocks of %d time steps | propagate %.3f s | screen %.3f s | write %.3f s | wall %.3f s\n",
+	 pipe.number_of_blocks, PIPELINE_BLOCK_STEPS, pipe.stage_seconds[PIPELINE_PROPAGATE], pipe.stage_seconds[PIPELINE_SCREEN],
+	 pipe.stage_seconds[PIPELINE_WRITE], wall_seconds() - start);
+
+  if (pipe.events_file != NULL) fclose(pipe.events_file);
+  pthread_cond_destroy(&pipe.changed);
+  pthread_mutex_destroy(&pipe.lock);
+  delete[] pipe.screen_tasks_done;
+  for(int slot = 0; slot < 2; slot++){
+    delete[] pipe.state[slot];
+    for(int task = 0; task < PIPELINE_SCREEN_TASKS; task++){
+      delete[] pipe.events[slot][task].events;
+    }
+  }
+
+  return pipe.risks;
+}
+#endif